@@ -0,0 +1,120 @@
+/*
+ * This file defines the class functions
+ * declared in "ConcurrentIntervalTree.h" header
+ *
+ * Copyright: SSRC - UC Santa Cruz
+ */
+
+#include "ConcurrentIntervalTree.h"
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#define CACHE_LINE_SIZE 64
+#define COUNTERS_PER_CACHE_LINE (CACHE_LINE_SIZE / sizeof(std::atomic<long>))
+
+/* Default Constructor */
+ConcurrentIntervalTree::ConcurrentIntervalTree(unsigned long passedDepthLevel, unsigned passedShards)
+    : snapshotTree(true, passedDepthLevel)
+{
+    _depthLevel = passedDepthLevel;
+    _shards = (passedShards == 0) ? 1 : passedShards;
+    _leafCount = snapshotTree.getLeafCount();
+
+    // Pad every shard to whole cache lines and align the
+    // block, so each shard starts on its own cache line
+    _shardStride = ((_leafCount + COUNTERS_PER_CACHE_LINE - 1) / COUNTERS_PER_CACHE_LINE) *
+                   COUNTERS_PER_CACHE_LINE;
+
+    void *block = NULL;
+    if (posix_memalign(&block, CACHE_LINE_SIZE,
+                       sizeof(std::atomic<long>) * _shardStride * _shards) != 0) {
+        throw std::bad_alloc();
+    }
+    leaves = static_cast<std::atomic<long>*>(block);
+    for (long i = 0; i < _shardStride * _shards; i++) {
+        new (&leaves[i]) std::atomic<long>(0);
+    }
+}
+
+/* Destructor */
+ConcurrentIntervalTree::~ConcurrentIntervalTree()
+{
+    for (long i = 0; i < _shardStride * _shards; i++) {
+        leaves[i].~atomic();
+    }
+    free(leaves);
+}
+
+/**
+ * Counts the observation in the leaf
+ * counters of the shard
+ *
+ * Arguments
+ *      observation: Observation to be added
+ *      shard: Shard to count in, taken modulo the shard count
+ */
+void
+ConcurrentIntervalTree::add(double observation, unsigned shard)
+{
+    // Only reads the intervals, which snapshots never write
+    long leaf = snapshotTree.getLeafIndex(observation);
+
+    if (leaf >= 0) {
+        leaves[(shard % _shards) * _shardStride + leaf].fetch_add(1, std::memory_order_relaxed);
+    } else {
+        std::cout << "[ADD] Observation not within limit" << std::endl;
+    }
+}
+
+/**
+ * Sums the leaf counters of all shards
+ * and loads them into the passed tree
+ *
+ * Arguments
+ *      out: Tree of the same depth to load the snapshot into
+ */
+void
+ConcurrentIntervalTree::snapshot(IntervalTree &out)
+{
+    std::vector<long> counts(_leafCount, 0);
+
+    if (out.getLeafCount() != _leafCount) {
+        std::cout << "[SNAPSHOT] Tree depth does not match" << std::endl;
+        return;
+    }
+
+    for (unsigned s = 0; s < _shards; s++) {
+        for (long i = 0; i < _leafCount; i++) {
+            counts[i] += leaves[s * _shardStride + i].load(std::memory_order_relaxed);
+        }
+    }
+    out.setLeafObservations(&counts[0]);
+}
+
+/**
+ * Call median calculator on a snapshot
+ */
+double
+ConcurrentIntervalTree::getApproxMedian()
+{
+    std::lock_guard<std::mutex> guard(snapshotLock);
+
+    snapshot(snapshotTree);
+    return snapshotTree.getApproxMedian();
+}
+
+/**
+ * Sum of the leaf counters of all shards
+ */
+long
+ConcurrentIntervalTree::getSize()
+{
+    long size = 0;
+
+    for (long i = 0; i < _shardStride * _shards; i++) {
+        size += leaves[i].load(std::memory_order_relaxed);
+    }
+
+    return size;
+}
@@ -0,0 +1,75 @@
+/*
+ * This File declares an Interval Tree that
+ * several threads can add observations to
+ * concurrently
+ *
+ * Copyright: SSRC - UC Santa Cruz
+ */
+
+#ifndef CONCURRENT_INTERVAL_TREE_H
+#define CONCURRENT_INTERVAL_TREE_H
+
+#include <atomic>
+#include <mutex>
+#include "IntervalTree.h"
+
+/*
+ * Only leaf counts are stored, as relaxed atomic
+ * counters, so an add is a single increment and
+ * writers never block each other. Each shard keeps
+ * its own cache line aligned leaf counters so
+ * writers using different shards do not share cache
+ * lines. Reads fold all shards into the leaves of a
+ * regular IntervalTree and sum the internal nodes
+ * from them, so every snapshot is self-consistent:
+ * each node holds exactly the sum of its children.
+ * While writers run, the leaves are read one at a
+ * time, so a snapshot is not the state of the tree
+ * at any single moment; it holds every add that
+ * finished before the read started and any subset
+ * of the adds running alongside it.
+ */
+class ConcurrentIntervalTree {
+    std::atomic<long> *leaves;      // Leaf counters of all shards
+    long _leafCount;                // Number of leaves in one shard
+    long _shardStride;              // Distance between the counters of two shards
+    unsigned _shards;               // Number of shards
+    unsigned long _depthLevel;      // Depth level of the tree
+
+    IntervalTree snapshotTree;      // Leaf positions for add, reused by getApproxMedian
+    std::mutex snapshotLock;        // Guards the counts of snapshotTree
+
+public:
+    ConcurrentIntervalTree(unsigned long, unsigned);
+    ~ConcurrentIntervalTree();
+
+    /**
+     * Add an observation through the given
+     * shard, safe to call from any thread
+     */
+    void add(double, unsigned);
+
+    /**
+     * Fold all shards into the passed tree,
+     * which must have the same depth
+     */
+    void snapshot(IntervalTree&);
+
+    /**
+     * Get the approximate median of a
+     * self-consistent snapshot of the tree.
+     * With concurrent adds the snapshot may
+     * include some of them and not others,
+     * so it need not match the tree at any
+     * single moment
+     */
+    double getApproxMedian();
+
+    /**
+     * Get the number of observations added
+     * to the tree
+     */
+    long getSize();
+};
+
+#endif /* CONCURRENT_INTERVAL_TREE_H */
@@ -0,0 +1,168 @@
+/*
+ * This file defines the class functions
+ * declared in "DecayedIntervalTree.h" header
+ *
+ * Copyright: SSRC - UC Santa Cruz
+ */
+
+#include "DecayedIntervalTree.h"
+
+/* Default Constructor */
+DecayedIntervalTree::DecayedIntervalTree(unsigned long passedDepthLevel, double passedDecayFactor)
+    : layout(true, passedDepthLevel)
+{
+    _decayFactor = passedDecayFactor;
+    _scale = 1.0;
+    nodesAdded = 0;
+
+    if (!(_decayFactor > 0.0 && _decayFactor <= 1.0)) {
+        std::cout << "[DECAY] Decay factor not within (0, 1], not decaying" << std::endl;
+        _decayFactor = 1.0;
+    }
+
+    _firstLeaf = layout.getLeafCount() - 1;
+    _treeSize = _firstLeaf + layout.getLeafCount();
+    weights = new double[_treeSize];
+    for (long i = 0; i < _treeSize; i++) {
+        weights[i] = 0;
+    }
+}
+
+/* Destructor */
+DecayedIntervalTree::~DecayedIntervalTree()
+{
+    delete [] weights;
+}
+
+/**
+ * Brings the stored weights back to the
+ * scale of the newest observation. This is
+ * the only operation that touches every node
+ * and runs once per DECAY_RENORMALIZE_LIMIT
+ * growth of the scale.
+ */
+void
+DecayedIntervalTree::_renormalize()
+{
+    for (long i = 0; i < _treeSize; i++) {
+        weights[i] /= _scale;
+    }
+    _scale = 1.0;
+}
+
+/**
+ * Decays all previous observations and adds
+ * the new one to its leaf and the leaf's
+ * ancestors
+ *
+ * Arguments
+ *      observation: Observation to be added
+ */
+void
+DecayedIntervalTree::add(double observation)
+{
+    long leaf = layout.getLeafIndex(observation);
+
+    if (leaf < 0) {
+        std::cout << "[ADD] Observation not within limit" << std::endl;
+        return;
+    }
+
+    decay(_decayFactor);
+    nodesAdded += 1;
+
+    for (long index = _firstLeaf + leaf; ; index = (index - 1) >> 1) {
+        weights[index] += _scale;
+        if (index == 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * Lowers the weight of every observation
+ * in O(1) by raising the weight of future ones
+ *
+ * Arguments
+ *      factor: Weight kept by the current observations
+ */
+void
+DecayedIntervalTree::decay(double factor)
+{
+    if (!(factor > 0.0 && factor <= 1.0)) {
+        std::cout << "[DECAY] Decay factor not within (0, 1]" << std::endl;
+        return;
+    }
+
+    _scale /= factor;
+    if (_scale > DECAY_RENORMALIZE_LIMIT) {
+        _renormalize();
+    }
+}
+
+/**
+ * Removes all observations from the tree
+ */
+void
+DecayedIntervalTree::clear()
+{
+    for (long i = 0; i < _treeSize; i++) {
+        weights[i] = 0;
+    }
+    _scale = 1.0;
+    nodesAdded = 0;
+}
+
+/**
+ * Call median calculator
+ */
+double
+DecayedIntervalTree::getApproxMedian()
+{
+    if (nodesAdded == 0 || weights[0] <= 0) {
+        std::cout << "[MEDIAN] Tree is Empty" << std::endl;
+        return -1;
+    } else {
+        return _getApproxMedian(0, weights[0] / 2.0);
+    }
+}
+
+/**
+ * Calculate the weighted median by descending
+ * towards the half weight point and interpolating
+ * within the leaf, like IntervalTree does with
+ * integer counts. Weights are compared in stored
+ * units since the scale cancels out.
+ *
+ * Arguments
+ *      index: Calculate median of Tree/SubTree at index
+ *      K: Stored weight to reach within the node
+ */
+double
+DecayedIntervalTree::_getApproxMedian(long index, double K)
+{
+    while (index < _firstLeaf) {
+        long leftChild = (index << 1) + 1;
+        long rightChild = (index << 1) + 2;
+
+        if (weights[leftChild] >= K) {
+            index = leftChild;
+        } else {
+            K = K - weights[leftChild];
+            index = rightChild;
+        }
+    }
+
+    Interval temp = layout.getLeafSpan(index - _firstLeaf);
+    double weight = 0.5;
+
+    if (weights[index] > 0) {
+        weight = K / weights[index];
+    }
+    // Rounding in the path sums can push K past the leaf weight
+    if (weight > 1.0) {
+        weight = 1.0;
+    }
+
+    return temp.low + ((temp.high - temp.low) * weight);
+}
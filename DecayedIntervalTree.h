@@ -0,0 +1,92 @@
+/*
+ * This File declares an Interval Tree whose
+ * observations lose weight exponentially over
+ * time, for breakpoint detection over long
+ * running streams
+ *
+ * Copyright: SSRC - UC Santa Cruz
+ */
+
+#ifndef DECAYED_INTERVAL_TREE_H
+#define DECAYED_INTERVAL_TREE_H
+
+#include "IntervalTree.h"
+
+/* Change this macro on basis of requirement */
+#define DECAY_RENORMALIZE_LIMIT (1e100)     // Scale at which stored weights are renormalized
+
+/*
+ * Instead of multiplying every node by the decay
+ * factor on each add, new observations are stored
+ * with a weight of _scale, which grows by
+ * 1 / decayFactor per add. The weight of any
+ * observation relative to the newest one is then
+ * stored / _scale. Once _scale gets large all nodes
+ * are divided by it so the weights never overflow.
+ *
+ * Weights are kept in the array layout of
+ * IntervalTree, and the leaf of an observation and
+ * the interval of a leaf come from an IntervalTree
+ * of the same depth, so both trees split intervals
+ * the same way.
+ *
+ * This is a standalone tree: Breakpoint still uses
+ * IntervalTree and does not decay its distances.
+ */
+class DecayedIntervalTree {
+    IntervalTree layout;            // Gives leaf positions and intervals, holds no observations
+    double *weights;                // Scaled weight of each node, IntervalTree layout
+    long _treeSize;                 // Size of the weights array
+    long _firstLeaf;                // Index of the leftmost leaf
+    double _decayFactor;            // Weight kept by older observations on every add
+    double _scale;                  // Stored weight of the newest observation
+    long nodesAdded;                // Number of Nodes added to tree
+
+    void _renormalize();
+    double _getApproxMedian(long, double);
+
+public:
+    DecayedIntervalTree(unsigned long, double);
+    ~DecayedIntervalTree();
+
+    /**
+     * Add an observation with a weight of one,
+     * decaying all previous observations
+     */
+    void add(double);
+
+    /**
+     * Decay all observations by an additional
+     * factor, e.g. once per elapsed time tick
+     */
+    void decay(double);
+
+    /**
+     * Remove all observations from the tree
+     */
+    void clear();
+
+    /**
+     * Get the approximate median of the
+     * observations weighted by their decay
+     */
+    double getApproxMedian();
+
+    /**
+     * Get the total decayed weight of the
+     * observations in the tree
+     */
+    double getWeight() {
+        return weights[0] / _scale;
+    }
+
+    /**
+     * Get the number of observations added
+     * to the tree
+     */
+    long getSize() {
+        return nodesAdded;
+    }
+};
+
+#endif /* DECAYED_INTERVAL_TREE_H */
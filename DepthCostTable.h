@@ -0,0 +1,103 @@
+/*
+ * Cost model of IntervalTree depths used by
+ * Breakpoint::tuneTreeDepth()
+ *
+ * Generated by "edm-test -c", do not edit.
+ */
+
+#ifndef DEPTH_COST_TABLE_H
+#define DEPTH_COST_TABLE_H
+
+struct DepthCost {
+    int sampleSizeLog10;        // Sample sizes of this row, rounded power of ten
+    unsigned long depth;        // Depth of the tree
+    double medianError;         // Mean absolute error of the approximate median
+    double buildNanos;          // Time to allocate and construct the tree
+    double addNanos;            // Time of one add
+    double medianNanos;         // Time of one median query
+};
+
+static const DepthCost depthCostTable[] = {
+    {1, 1, 0.265611, 127.5, 27.0327, 17.9688},
+    {1, 2, 0.0821373, 95, 42.9107, 14.625},
+    {1, 3, 0.0349559, 173.5, 63.119, 16.1562},
+    {1, 4, 0.0115184, 117, 81.9077, 18.75},
+    {1, 5, 0.00891425, 136.5, 98.3452, 23.0938},
+    {1, 6, 0.00370592, 281.5, 100.098, 26.5312},
+    {1, 7, 0.00370592, 289, 110.17, 27.7812},
+    {1, 8, 0.00370592, 510.5, 119.268, 26.7188},
+    {1, 9, 0.000915711, 798, 125.795, 30.875},
+    {1, 10, 0.00189227, 1348, 142.756, 33.9062},
+    {1, 11, 0.00238055, 2911, 149.827, 34.9375},
+    {1, 12, 0.00238055, 6728, 162.824, 39.25},
+    {1, 13, 0.00238055, 12551, 184.565, 41.2188},
+    {1, 14, 0.00231952, 24221.5, 173.619, 40.25},
+    {1, 15, 0.00231952, 48321, 188.423, 43.2812},
+    {1, 16, 0.00230426, 101294, 196.565, 47},
+    {2, 1, 0.128502, 135.817, 13.3684, 14.2094},
+    {2, 2, 0.0298657, 78.5833, 27.2672, 13.6323},
+    {2, 3, 0.0107209, 93.5, 41.7271, 16.1896},
+    {2, 4, 0.00900017, 92.25, 58.6556, 17.9146},
+    {2, 5, 0.00621414, 115.75, 73.2318, 20.8844},
+    {2, 6, 0.00445285, 248.65, 87.1641, 22.4635},
+    {2, 7, 0.00311565, 251.933, 100.571, 23.6365},
+    {2, 8, 0.00226306, 412.433, 112.956, 24.9635},
+    {2, 9, 0.00181312, 694.5, 123.235, 26.1677},
+    {2, 10, 0.0016075, 1182.55, 133.635, 28.0677},
+    {2, 11, 0.00151456, 2408.72, 145.305, 29.5615},
+    {2, 12, 0.00149547, 5717.3, 161.046, 30.9812},
+    {2, 13, 0.00145207, 12131.5, 175.229, 33.474},
+    {2, 14, 0.00144088, 24914.5, 181.551, 34.7875},
+    {2, 15, 0.00143916, 49226.6, 194.982, 36.1292},
+    {2, 16, 0.00143865, 101537, 220.942, 39.8771},
+    {3, 1, 0.106212, 190.669, 12.518, 18.3835},
+    {3, 2, 0.021817, 83.2446, 25.2383, 14.7797},
+    {3, 3, 0.00573371, 102.612, 38.38, 16.9415},
+    {3, 4, 0.00412956, 111.504, 53.4102, 18.5189},
+    {3, 5, 0.00292575, 128.259, 68.6791, 20.8781},
+    {3, 6, 0.0019198, 295.842, 85.8874, 22.6906},
+    {3, 7, 0.00142563, 329.489, 100.783, 23.5733},
+    {3, 8, 0.000966845, 635.647, 115.339, 25.7433},
+    {3, 9, 0.000653435, 725.712, 128.025, 27.5832},
+    {3, 10, 0.000506561, 1405.09, 140.861, 28.7491},
+    {3, 11, 0.000378802, 3024.55, 156.339, 31.0243},
+    {3, 12, 0.000299581, 6299.07, 171.229, 32.9164},
+    {3, 13, 0.00027651, 14189.1, 184.846, 35.3076},
+    {3, 14, 0.000271117, 28533.8, 198.367, 37.6731},
+    {3, 15, 0.000267786, 58564.6, 213.866, 39.7572},
+    {3, 16, 0.000267238, 131615, 237.028, 42.6754},
+    {4, 1, 0.0837131, 1374.6, 14.3155, 39.4917},
+    {4, 2, 0.0161323, 185.8, 27.272, 20.9542},
+    {4, 3, 0.00347244, 208.067, 41.9934, 24.6625},
+    {4, 4, 0.0014979, 257.333, 55.1622, 27.1333},
+    {4, 5, 0.000476405, 311.667, 75.2798, 31.2958},
+    {4, 6, 0.000367689, 1397.87, 87.4132, 33.4917},
+    {4, 7, 0.000242113, 1478.2, 104.646, 36.7167},
+    {4, 8, 0.00020691, 912.467, 121.642, 42.8125},
+    {4, 9, 0.000167126, 1967.07, 136.545, 43.9542},
+    {4, 10, 0.000112068, 3459.8, 162.809, 44.8958},
+    {4, 11, 9.3282e-05, 6168, 173.207, 51.225},
+    {4, 12, 5.16771e-05, 12872.5, 194.703, 54.4875},
+    {4, 13, 2.17811e-05, 29281.9, 203.528, 58.5708},
+    {4, 14, 2.05349e-05, 56812.1, 219.148, 64.1583},
+    {4, 15, 1.90819e-05, 107560, 243.494, 61.3167},
+    {4, 16, 1.19138e-05, 235679, 282.259, 72.3708},
+    {5, 1, 0.120936, 1917.71, 13.2266, 44.2969},
+    {5, 2, 0.0232235, 324.583, 26.0292, 24.7292},
+    {5, 3, 0.00412424, 412.75, 41.4038, 31.6953},
+    {5, 4, 0.00147325, 446.208, 53.6105, 34.5391},
+    {5, 5, 0.000433053, 485.667, 69.8102, 39.1016},
+    {5, 6, 0.000209899, 2188.96, 85.8202, 41.4844},
+    {5, 7, 0.000107756, 2181.46, 101.026, 43.4115},
+    {5, 8, 9.40813e-05, 2049.38, 118.493, 54.8542},
+    {5, 9, 8.16403e-05, 3778.88, 137.409, 54.3229},
+    {5, 10, 5.13285e-05, 4782.67, 154.659, 54.5911},
+    {5, 11, 3.41363e-05, 7632.75, 174.338, 67.4453},
+    {5, 12, 2.37241e-05, 14788.3, 196.164, 75.5312},
+    {5, 13, 2.1085e-05, 32434, 203.481, 79.3438},
+    {5, 14, 1.16654e-05, 64684.7, 221.426, 84.2552},
+    {5, 15, 7.48266e-06, 179491, 246.354, 88.4531},
+    {5, 16, 5.10299e-06, 292024, 277.835, 95.6172},
+};
+
+#endif /* DEPTH_COST_TABLE_H */
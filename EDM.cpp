@@ -6,7 +6,15 @@
  * Copyright: Yash Gupta, SSRC - UC Santa Cruz
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "DepthCostTable.h"
 #include "EDM.h"
 
 using namespace std;
@@ -39,6 +47,33 @@ _scaleTimeSeries(double *timeSeries, long count) {
     }
 }
 
+/**
+ * Estimates the running time of one detection
+ * pass from the calibrated costs of a tree depth.
+ * Initialization adds the 2 * delta^2 window
+ * distances, then every (tau, kappa) step of the
+ * sweep does one add and one median query.
+ *
+ * Arguments
+ *      cost: Calibrated costs of the tree depth
+ *      count: The number of observations in series
+ *      delta: Delta variable of the detection
+ */
+static double
+_estimateNanos(const DepthCost &cost, long count, long delta)
+{
+    double initAdds = 2.0 * (double)delta * (double)delta;
+    double steps = 0;
+    long span = count - (2 * delta) + 1;
+
+    if (span > 0) {
+        steps = (double)span * (double)(span + 1) / 2.0;
+    }
+
+    return (3 * cost.buildNanos) + ((initAdds + steps) * cost.addNanos) +
+           ((steps + 3) * cost.medianNanos);
+}
+
 /* Default Constructor */
 Breakpoint::Breakpoint(double *passedTimeSeries, long passedCount, long passedDelta, long passedDepth)
 {
@@ -53,6 +88,9 @@ Breakpoint::Breakpoint(double *passedTimeSeries, long passedCount, long passedDe
 
     tau = delta;
     kappa = tau * 2;
+    bestStat = 0;
+    bestLocation = -1;
+    hasLocation = false;
 
     _scaleTimeSeries(timeSeries, timeSeriesCount);
 }
@@ -71,13 +109,238 @@ Breakpoint::~Breakpoint() {
 long
 Breakpoint::getBreakpointLocation()
 {
-    double median1, median2, median3;
-    short forwardMove = 0;
+    wiDistLeft->clear();
 
-    // Initialize within distance trees
+    // Initialize left within distance tree
     for (long i = 0; i < delta; ++i) {
         for (long j = i + 1; j < delta; ++j) {
             wiDistLeft->add(abs(timeSeries[i] - timeSeries[j]));
+        }
+    }
+
+    _initWindowTrees();
+    return _sweep();
+}
+
+/*
+ * Leaf counts of an IntervalTree together with the
+ * leaf holding its median. Adding one observation
+ * moves the median rank by at most one, so the
+ * median leaf is walked to from where it was rather
+ * than searched for from the root. The median follows
+ * the leaf interpolation of IntervalTree exactly.
+ */
+struct LeafMedian {
+    vector<long> counts;    // Observations in each leaf
+    long total;             // Observations in all leaves
+    long leaf;              // Leftmost leaf whose cumulative count reaches K
+    long below;             // Observations in the leaves left of leaf
+
+    void reset(long leafCount) {
+        counts.assign(leafCount, 0);
+        total = 0;
+        leaf = 0;
+        below = 0;
+    }
+
+    void add(long index) {
+        if (index < 0) {
+            return;
+        }
+        counts[index] += 1;
+        total += 1;
+        if (index < leaf) {
+            below += 1;
+        }
+    }
+
+    double median(IntervalTree *spans) {
+        long K = ceil(total / 2.0);
+
+        if (total == 0) {
+            cout << "[MEDIAN] Tree is Empty" << endl;
+            return -1;
+        }
+        while (below + counts[leaf] < K) {
+            below += counts[leaf];
+            leaf += 1;
+        }
+        while (below >= K) {
+            leaf -= 1;
+            below -= counts[leaf];
+        }
+
+        Interval temp = spans->getLeafSpan(leaf);
+        double weight = (double)(K - below) / (double)counts[leaf];
+        return temp.low + ((temp.high - temp.low) * weight);
+    }
+};
+
+/**
+ * The tau sweep of Breakpoint::_sweep on leaf
+ * counts, taking the leaf of every adjacent
+ * distance from a table shared by all scales
+ *
+ * Arguments
+ *      adjacentLeaf: Leaf of |x[k] - x[k - 1]| at index k
+ *      count: The number of observations in series
+ *      delta: Delta variable of this scale
+ *      bwMedian: Median of the between distances
+ *      leftMedian: Median of the left within distances
+ *      right: Right within distances, initialized
+ *      spans: Tree of the same depth giving leaf intervals
+ */
+static long
+_sweepLeafCounts(const vector<long> &adjacentLeaf, long count, long delta,
+                 double bwMedian, double leftMedian, LeafMedian &right,
+                 IntervalTree *spans)
+{
+    long tau = delta;
+    long kappa = tau * 2;
+    double stat;
+    double bestStat;
+    long bestLocation;
+    short forwardMove = 0;
+
+    bestStat = (tau * (kappa - tau)) / kappa;
+    bestStat = bestStat * (2 * bwMedian - leftMedian - right.median(spans));
+    bestLocation = (delta - 1);
+    tau = (delta - 1);
+
+    while (tau < (count - delta)) {
+        ++tau;
+        for (long step = 0; step < count - (tau + (delta - 1)); ++step) {
+            // Forward updates walk kappa up, backward updates down
+            long tempKappa = forwardMove ? tau + (delta - 1) + step : (count - 1) - step;
+
+            right.add(adjacentLeaf[tempKappa]);
+            stat = (tau * (tempKappa - tau)) / tempKappa;
+            stat = stat * (2 * bwMedian - leftMedian - right.median(spans));
+            if (stat > bestStat) {
+                bestStat = stat;
+                bestLocation = tau;
+            }
+        }
+        forwardMove = 1 - forwardMove;
+    }
+
+    return bestLocation;
+}
+
+/**
+ * Runs the detection for several delta values over
+ * the same series and returns the same locations as
+ * separate runs. The leaf of every distance used by
+ * any scale is computed once: the pairwise distances
+ * of the initial windows and the adjacent distances
+ * added by the sweeps. Each scale then works on leaf
+ * counts only, so neither adds nor medians descend a
+ * tree. Deltas are processed in ascending order so
+ * the left within distances, whose window [0, delta)
+ * is nested across scales, are only extended by the
+ * pairs introduced by each larger window.
+ *
+ * The Breakpoint's own trees and location are not
+ * touched.
+ *
+ * Arguments
+ *      deltas: The delta values to sweep, in any order
+ *      deltaCount: Number of entries in deltas
+ *      locations: Receives the best location for deltas[i]
+ *                 at locations[i], or -1 if deltas[i] does
+ *                 not fit the series
+ */
+void
+Breakpoint::getBreakpointLocations(const long *deltas, long deltaCount, long *locations)
+{
+    vector<long> order;
+    long leafCount = wiDistLeft->getLeafCount();
+    long window = 0;        // Pair leaves are known within [0, window)
+    long leftWindow = 0;    // left holds all pairs within [0, leftWindow)
+    long zeroLeaf = wiDistLeft->getLeafIndex(0.0);
+    vector<long> pairLeaf;  // Leaf of |x[i] - x[j]|, i < j, at j * (j - 1) / 2 + i
+    vector<long> adjacentLeaf(timeSeriesCount, -1);
+    LeafMedian left, right, between;
+
+    for (long i = 0; i < deltaCount; ++i) {
+        if (deltas[i] < 1 || (2 * deltas[i] - 1) > timeSeriesCount) {
+            cout << "[MULTISCALE] Delta " << deltas[i] << " does not fit the series" << endl;
+            locations[i] = -1;
+            continue;
+        }
+        order.push_back(i);
+        if (2 * deltas[i] - 1 > window) {
+            window = 2 * deltas[i] - 1;
+        }
+    }
+    sort(order.begin(), order.end(), [deltas](long a, long b) {
+        return deltas[a] < deltas[b];
+    });
+
+    // Distance blocks shared by all scales
+    pairLeaf.resize(window * (window - 1) / 2 + 1);
+    for (long j = 1; j < window; ++j) {
+        for (long i = 0; i < j; ++i) {
+            pairLeaf[j * (j - 1) / 2 + i] = wiDistLeft->getLeafIndex(abs(timeSeries[i] - timeSeries[j]));
+        }
+    }
+    for (long k = 1; k < timeSeriesCount; ++k) {
+        adjacentLeaf[k] = wiDistLeft->getLeafIndex(abs(timeSeries[k] - timeSeries[k - 1]));
+    }
+
+    left.reset(leafCount);
+    for (size_t k = 0; k < order.size(); ++k) {
+        long index = order[k];
+        long scale = deltas[index];
+
+        // Extend left within distances to the new window
+        for (long j = leftWindow; j < scale; ++j) {
+            for (long i = 0; i < j; ++i) {
+                left.add(pairLeaf[j * (j - 1) / 2 + i]);
+            }
+        }
+        if (scale > leftWindow) {
+            leftWindow = scale;
+        }
+
+        right.reset(leafCount);
+        between.reset(leafCount);
+        for (long i = 0; i < scale; ++i) {
+            for (long j = i + 1; j < scale; ++j) {
+                right.add(pairLeaf[(j + scale - 1) * (j + scale - 2) / 2 + (i + scale - 1)]);
+            }
+        }
+        for (long i = 0; i < scale; ++i) {
+            for (long j = 0; j < scale; ++j) {
+                long a = min(i, j + (scale - 1));
+                long b = max(i, j + (scale - 1));
+
+                between.add(a == b ? zeroLeaf : pairLeaf[b * (b - 1) / 2 + a]);
+            }
+        }
+
+        locations[index] = _sweepLeafCounts(adjacentLeaf, timeSeriesCount, scale,
+                                            between.median(wiDistLeft),
+                                            left.median(wiDistLeft),
+                                            right, wiDistLeft);
+    }
+}
+
+/**
+ * Fills the right within distance tree and the
+ * between distance tree for the current delta.
+ * Both windows start at (delta - 1) and so have
+ * to be rebuilt whenever delta changes.
+ */
+void
+Breakpoint::_initWindowTrees()
+{
+    wiDistRight->clear();
+    bwDistTree->clear();
+
+    // Initialize right within distance tree
+    for (long i = 0; i < delta; ++i) {
+        for (long j = i + 1; j < delta; ++j) {
             wiDistRight->add(abs(timeSeries[i + (delta - 1)] - timeSeries[j + (delta - 1)]));
         }
     }
@@ -88,13 +351,28 @@ Breakpoint::getBreakpointLocation()
             bwDistTree->add(abs(timeSeries[i] - timeSeries[j + (delta - 1)]));
         }
     }
+}
 
-    median1 = bwDistTree->getApproxMedian();
-    median2 = wiDistLeft->getApproxMedian();
+/**
+ * Sweeps tau over the series using the initialized
+ * trees. Only the right within distance tree changes
+ * during the sweep, so the other two medians are
+ * computed once up front.
+ */
+long
+Breakpoint::_sweep()
+{
+    double median3;
+    short forwardMove = 0;
+
+    bwDistMedian = bwDistTree->getApproxMedian();
+    wiDistLeftMedian = wiDistLeft->getApproxMedian();
     median3 = wiDistRight->getApproxMedian();
 
+    tau = delta;
+    kappa = tau * 2;
     bestStat = (tau * (kappa - tau)) / kappa;
-    bestStat = bestStat * (2 * median1 - median2 - median3);
+    bestStat = bestStat * (2 * bwDistMedian - wiDistLeftMedian - median3);
     bestLocation = (delta - 1);
     tau = (delta - 1);
 
@@ -107,9 +385,117 @@ Breakpoint::getBreakpointLocation()
         forwardMove = 1 - forwardMove;
     }
 
+    hasLocation = true;
     return bestLocation;
 }
 
+/**
+ * Estimates how likely the detected breakpoint is
+ * to be noise by rerunning the detection on random
+ * permutations of the series. Each worker thread owns
+ * one Breakpoint over a private copy of the series,
+ * so its trees and scratch buffer are reused across
+ * all of its permutations.
+ *
+ * Permutation i is always drawn from a generator
+ * seeded with seed + i, whichever thread runs it, so
+ * a given seed gives the same p-value for any number
+ * of threads. When earlyStop is set the rule is only
+ * checked on complete prefixes of 32, 64, ...
+ * permutations, and the test stops at the first
+ * prefix whose p-value is more than three standard
+ * errors above or below alpha. Permutations past that
+ * prefix that already ran are discarded.
+ *
+ * Arguments
+ *      permutations: Maximum number of permutations to run
+ *      alpha: Significance level used for early stopping
+ *      threads: Worker threads, 0 to use all hardware threads
+ *      earlyStop: Whether to stop once the decision is clear
+ *      seed: Seed of the first permutation
+ */
+BreakpointSignificance
+Breakpoint::getSignificance(long permutations, double alpha, unsigned threads,
+                            bool earlyStop, unsigned long seed)
+{
+    const long checkInterval = 32;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    BreakpointSignificance result;
+    atomic<long> nextPermutation(0);
+    atomic<bool> stop(false);
+    mutex resultsLock;
+    vector<signed char> exceeds(permutations > 0 ? permutations : 0, -1);
+    long completed = 0;         // Permutations [0, completed) have finished
+    long completedExceeds = 0;  // Exceedances within [0, completed)
+    long stopAt = permutations; // Length of the prefix the result is taken from
+    vector<thread> workers;
+    vector<double> series(timeSeries, timeSeries + timeSeriesCount);
+    double observedStat;
+
+    if (!hasLocation) {
+        getBreakpointLocation();
+    }
+    observedStat = bestStat;
+
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    if ((long)threads > permutations) {
+        threads = (permutations > 0) ? permutations : 1;
+    }
+
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.push_back(thread([&]() {
+            vector<double> scratch(series);
+            Breakpoint worker(scratch.data(), timeSeriesCount, delta, treeDepth);
+
+            while (!stop.load(memory_order_relaxed)) {
+                long index = nextPermutation.fetch_add(1, memory_order_relaxed);
+                if (index >= permutations) {
+                    break;
+                }
+
+                mt19937_64 generator(seed + index);
+                copy(series.begin(), series.end(), scratch.begin());
+                shuffle(scratch.begin(), scratch.end(), generator);
+                worker.getBreakpointLocation();
+
+                lock_guard<mutex> guard(resultsLock);
+                exceeds[index] = (worker.bestStat >= observedStat) ? 1 : 0;
+                while (completed < stopAt && exceeds[completed] >= 0) {
+                    completedExceeds += exceeds[completed];
+                    completed += 1;
+
+                    if (earlyStop && completed % checkInterval == 0) {
+                        double p = (double)(completedExceeds + 1) / (double)(completed + 1);
+                        double error = sqrt(p * (1 - p) / (double)completed);
+
+                        if (p - 3 * error > alpha || p + 3 * error < alpha) {
+                            stopAt = completed;
+                            stop.store(true, memory_order_relaxed);
+                        }
+                    }
+                }
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < workers.size(); ++t) {
+        workers[t].join();
+    }
+
+    result.permutations = completed;
+    result.exceedances = completedExceeds;
+    result.pValue = (double)(result.exceedances + 1) / (double)(result.permutations + 1);
+    result.earlyStopped = (result.permutations < permutations);
+    result.elapsedSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    return result;
+}
+
 /**
  * Forward Update operation of the algorithm
  */
@@ -117,18 +503,16 @@ void
 Breakpoint::forwardUpdate()
 {
     double stat;
-    double median1, median2, median3;
+    double median3;
     long tempKappa;
 
     ++tau;
     for (tempKappa = tau + (delta - 1); tempKappa < timeSeriesCount; ++tempKappa) {
         wiDistRight->add(abs(/*-*/timeSeries[tempKappa] - timeSeries[tempKappa - 1]));
-        median1 = bwDistTree->getApproxMedian();
-        median2 = wiDistLeft->getApproxMedian();
         median3 = wiDistRight->getApproxMedian();
 
         stat = (tau * (tempKappa - tau)) / tempKappa;
-        stat = stat * (2 * median1 - median2 - median3);
+        stat = stat * (2 * bwDistMedian - wiDistLeftMedian - median3);
         if (stat > bestStat) {
             bestStat = stat;
             bestLocation = tau;
@@ -143,19 +527,17 @@ void
 Breakpoint::backwardUpate()
 {
     double stat;
-    double median1, median2, median3;
+    double median3;
     long tempKappa;
 
     ++tau;
     tempKappa = (timeSeriesCount - 1);
     while (tempKappa >= (tau + (delta - 1))) {
         wiDistRight->add(abs(timeSeries[tempKappa] - timeSeries[tempKappa - 1]));
-        median1 = bwDistTree->getApproxMedian();
-        median2 = wiDistLeft->getApproxMedian();
         median3 = wiDistRight->getApproxMedian();
 
         stat = (tau * (tempKappa - tau)) / tempKappa;
-        stat = stat * (2 * median1 - median2 - median3);
+        stat = stat * (2 * bwDistMedian - wiDistLeftMedian - median3);
         if (stat > bestStat) {
             bestStat = stat;
             bestLocation = tau;
@@ -163,3 +545,150 @@ Breakpoint::backwardUpate()
         tempKappa = tempKappa - 1;
     }
 }
+
+/**
+ * Finds the calibrated sample size closest to
+ * the given number of samples
+ *
+ * Arguments
+ *      samples: Number of observations in a tree
+ */
+static int
+_nearestSampleSizeLog10(double samples)
+{
+    const long rows = sizeof(depthCostTable) / sizeof(depthCostTable[0]);
+    int sampleSizeLog10 = (int)floor(log10(samples > 1 ? samples : 1) + 0.5);
+    int nearest = depthCostTable[0].sampleSizeLog10;
+
+    for (long i = 0; i < rows; ++i) {
+        if (abs(depthCostTable[i].sampleSizeLog10 - sampleSizeLog10) <
+            abs(nearest - sampleSizeLog10)) {
+            nearest = depthCostTable[i].sampleSizeLog10;
+        }
+    }
+
+    return nearest;
+}
+
+/**
+ * Lists the tree depths present in the cost
+ * model, shallowest first
+ */
+static vector<unsigned long>
+_calibratedDepths()
+{
+    const long rows = sizeof(depthCostTable) / sizeof(depthCostTable[0]);
+    vector<unsigned long> depths;
+
+    for (long i = 0; i < rows; ++i) {
+        depths.push_back(depthCostTable[i].depth);
+    }
+    sort(depths.begin(), depths.end());
+    depths.erase(unique(depths.begin(), depths.end()), depths.end());
+
+    return depths;
+}
+
+/**
+ * Estimates the median error and running time of
+ * a detection with the given tree depth from the
+ * cost model in DepthCostTable.h. The smallest tree
+ * holds delta (delta - 1) / 2 distances while the
+ * right within distance tree grows through the
+ * sweep, so the error is the worst calibrated error
+ * over every sample size the trees pass through.
+ * The time uses the costs measured at the final size
+ * of the right tree, which receives most adds.
+ *
+ * Arguments
+ *      count: The number of observations in series
+ *      delta: Delta variable of the detection
+ *      depth: Tree depth to estimate
+ *      medianError: Receives the estimated median error
+ *      seconds: Receives the estimated running time
+ *
+ * Returns false if the depth was not calibrated
+ */
+bool
+Breakpoint::estimateTreeDepth(long count, long delta, unsigned long depth,
+                              double *medianError, double *seconds)
+{
+    const long rows = sizeof(depthCostTable) / sizeof(depthCostTable[0]);
+    long span = count - (2 * delta) + 1;
+    double steps = (span > 0) ? (double)span * (double)(span + 1) / 2.0 : 0;
+    double smallest = (double)delta * (double)(delta - 1) / 2.0;
+    int low = _nearestSampleSizeLog10(smallest);
+    int high = _nearestSampleSizeLog10(max(smallest + steps, (double)delta * (double)delta));
+    const DepthCost *largest = NULL;
+    bool found = false;
+
+    *medianError = 0;
+    for (long i = 0; i < rows; ++i) {
+        const DepthCost &cost = depthCostTable[i];
+
+        if (cost.depth != depth || cost.sampleSizeLog10 < low || cost.sampleSizeLog10 > high) {
+            continue;
+        }
+        found = true;
+        *medianError = max(*medianError, cost.medianError);
+        if (cost.sampleSizeLog10 == high) {
+            largest = &cost;
+        }
+    }
+    if (!found || largest == NULL) {
+        return false;
+    }
+
+    *seconds = _estimateNanos(*largest, count, delta) / 1e9;
+    return true;
+}
+
+/**
+ * Picks the tree depth for a detection over count
+ * observations from the estimates of
+ * estimateTreeDepth. Returns the shallowest depth
+ * whose median error and estimated time are both
+ * within limits, otherwise the most accurate depth
+ * that fits the time limit, otherwise the fastest
+ * depth.
+ *
+ * Arguments
+ *      count: The number of observations in series
+ *      delta: Delta variable of the detection
+ *      maxMedianError: Median error target, 0 for the most accurate
+ *      maxSeconds: Time budget of a detection, 0 for no limit
+ */
+unsigned long
+Breakpoint::tuneTreeDepth(long count, long delta, double maxMedianError, double maxSeconds)
+{
+    unsigned long accurate = 0;
+    unsigned long fastest = 0;
+    double accurateError = 0;
+    double fastestSeconds = 0;
+    vector<unsigned long> depths = _calibratedDepths();
+
+    for (size_t i = 0; i < depths.size(); ++i) {
+        unsigned long depth = depths[i];
+        double error, seconds;
+
+        if (!estimateTreeDepth(count, delta, depth, &error, &seconds)) {
+            continue;
+        }
+        if (fastest == 0 || seconds < fastestSeconds) {
+            fastest = depth;
+            fastestSeconds = seconds;
+        }
+        if (maxSeconds > 0 && seconds > maxSeconds) {
+            continue;
+        }
+        if (maxMedianError > 0 && error <= maxMedianError) {
+            return depth;
+        }
+        if (accurate == 0 || error < accurateError) {
+            accurate = depth;
+            accurateError = error;
+        }
+    }
+
+    return (accurate != 0) ? accurate : fastest;
+}
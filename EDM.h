@@ -8,6 +8,14 @@
 
 #include "IntervalTree.h"
 
+struct BreakpointSignificance {
+    double pValue;          // Permutation p-value of the detected breakpoint
+    long permutations;      // Permutations actually evaluated
+    long exceedances;       // Permutations whose statistic reached the observed one
+    bool earlyStopped;      // Test stopped before running all permutations
+    double elapsedSeconds;  // Wall clock time spent in the test
+};
+
 class Breakpoint {
     long tau;               // EDM Variable
     long kappa;             // EDM Variable
@@ -17,16 +25,35 @@ class Breakpoint {
     long delta;             // Delta variable which breaks up total observations in series
     long treeDepth;         // Depth of tree to be made
     long bestLocation;      // Breakpoint Location
+    bool hasLocation;       // Whether bestStat and bestLocation are valid
+    double bwDistMedian;        // Median of T-ab, constant during the sweep
+    double wiDistLeftMedian;    // Median of T-a, constant during the sweep
 
     IntervalTree *wiDistLeft;       // Left half of within distance tree (T-a)
     IntervalTree *wiDistRight;      // Right half of within distance tree (T-b)
     IntervalTree *bwDistTree;       // The between distance tree (T-ab)
 
+    void _initWindowTrees();
+    long _sweep();
+
 public:
     Breakpoint(double*, long, long, long);
     ~Breakpoint();
 
     long getBreakpointLocation();
+    void getBreakpointLocations(const long*, long, long*);
+    BreakpointSignificance getSignificance(long, double, unsigned, bool, unsigned long);
+
+    static unsigned long tuneTreeDepth(long, long, double, double);
+    static bool estimateTreeDepth(long, long, unsigned long, double*, double*);
+
+    /**
+     * Get the statistic of the last
+     * detected breakpoint location
+     */
+    double getBestStat() {
+        return bestStat;
+    }
 
     void forwardUpdate();
     void backwardUpate();
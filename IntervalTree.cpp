@@ -6,7 +6,9 @@
  * Copyright: Yash Gupta, SSRC - UC Santa Cruz
  */
 
+#include <algorithm>
 #include "IntervalTree.h"
+#include <vector>
 
 /* Default Constructor */
 IntervalTree::IntervalTree(bool initialize, unsigned long passedDepthLevel)
@@ -103,6 +105,103 @@ IntervalTree::_constructTree(double low, double high)
     }
 }
 
+/**
+ * Resets the observation count of every
+ * node so the tree can be refilled without
+ * reallocating or reconstructing intervals
+ */
+void
+IntervalTree::clear()
+{
+    nodesAdded = 0;
+    if (!isInitialized) {
+        return;
+    }
+
+    for (long i = 0; i < _treeSize; i++) {
+        tree[i].observationsInInterval = 0;
+    }
+}
+
+/**
+ * Copies the observation count of every
+ * leaf, from left to right
+ *
+ * Arguments
+ *      counts: Receives getLeafCount() counts
+ */
+void
+IntervalTree::getLeafObservations(long *counts)
+{
+    long firstLeaf = _treeSize >> 1;
+
+    for (long i = firstLeaf; i < _treeSize; i++) {
+        counts[i - firstLeaf] = isInitialized ? tree[i].observationsInInterval : 0;
+    }
+}
+
+/**
+ * Replaces the observations of the tree with
+ * the given leaf counts. The internal nodes are
+ * summed bottom up, the same counts a sequence
+ * of add calls would have produced.
+ *
+ * Arguments
+ *      counts: getLeafCount() counts, from left to right
+ */
+void
+IntervalTree::setLeafObservations(const long *counts)
+{
+    long firstLeaf = _treeSize >> 1;
+
+    if (!isInitialized) {
+        std::cout << "[LOAD] Tree is not Initialized" << std::endl;
+        return;
+    }
+
+    for (long i = firstLeaf; i < _treeSize; i++) {
+        tree[i].observationsInInterval = counts[i - firstLeaf];
+    }
+    for (long i = firstLeaf - 1; i >= 0; i--) {
+        tree[i].observationsInInterval = tree[(i << 1) + 1].observationsInInterval +
+                                         tree[(i << 1) + 2].observationsInInterval;
+    }
+    nodesAdded = tree[0].observationsInInterval;
+}
+
+/**
+ * Finds the leaf an observation falls in
+ * by following the same path as _add
+ *
+ * Arguments
+ *      observation: Observation to locate
+ *
+ * Returns the leaf position, from left to
+ * right, or -1 if the observation is out of limit
+ */
+long
+IntervalTree::getLeafIndex(double observation)
+{
+    long index = 0;
+    long firstLeaf = _treeSize >> 1;
+
+    if (!isInitialized || !(observation >= ROOT_BEG && observation <= ROOT_END)) {
+        return -1;
+    }
+
+    while (index < firstLeaf) {
+        Interval temp = tree[index].intervalSpan;
+
+        if (observation < ((temp.low + temp.high) / 2.0)) {
+            index = (index << 1) + 1;
+        } else {
+            index = (index << 1) + 2;
+        }
+    }
+
+    return index - firstLeaf;
+}
+
 /**
  * Creates an interval structure based on
  * the observation and Creates a node
@@ -191,67 +290,143 @@ IntervalTree::_getApproxMedian(long index, long K)
 {
     long leftChild = (index << 1) + 1;
     long rightChild = (index << 1) + 2;
+    double value;
+
+    if (_resolveRank(index, K, &value)) {
+        return value;
+    }
+
+    if (tree[leftChild].observationsInInterval >= K) {
+        return _getApproxMedian(leftChild, K);
+    } else {
+        K = K - tree[leftChild].observationsInInterval;
+        return _getApproxMedian(rightChild, K);
+    }
+
+    // Control flow should never reach here. Error!
+    return -1;
+}
+
+/**
+ * Resolve the K-th ranked observation of the
+ * Tree/SubTree at index if it can be answered
+ * without descending further, i.e. at a leaf.
+ * The rank is interpolated linearly within the
+ * leaf, so a K equal to the observations of the
+ * leaf maps to its upper bound.
+ *
+ * Arguments
+ *      index: Node of the tree to resolve at
+ *      K: Rank within the observations of the node
+ *      value: Receives the approximate value on success
+ *
+ * Returns true if value was set
+ */
+bool
+IntervalTree::_resolveRank(long index, long K, double *value)
+{
     Interval temp = tree[index].intervalSpan;
-    Interval tempLeft;
-    Interval tempRight;
 
-    if (isLeafNode(index)) {
-        if (K != tree[index].observationsInInterval) {
-            double low = temp.low;
-            double high = temp.high;
-            double weight = (double)K / (double)(tree[index].observationsInInterval);
-
-            return low + ((high - low) * weight);
-        } else if (K == tree[index].observationsInInterval) {
-            if (index + 1 < _treeSize) {
-                Interval tempNext = tree[index + 1].intervalSpan;
-                long observationsInNextInterval = tree[index + 1].observationsInInterval;
-                long observationsInCurrentInterval = tree[index].observationsInInterval;
-                double currentLow = temp.low;
-                double currentHigh = temp.high;
-                double nextLow = tempNext.low;
-                double nextHigh = tempNext.high;
-
-                double currentWeight = (currentHigh - currentLow) / (double)observationsInCurrentInterval;
-                double nextWeight = (nextHigh - nextLow) / (double)observationsInNextInterval;
-
-                return (currentWeight + nextWeight) / 2.0;
-            } else {
-                double low = temp.low;
-                double high = temp.high;
-                double weight = (double)K / (double)(tree[index].observationsInInterval);
-
-                return low + ((high - low) * weight);
-            }
+    if (!isLeafNode(index)) {
+        return false;
+    }
+
+    double weight = (double)K / (double)(tree[index].observationsInInterval);
+    *value = temp.low + ((temp.high - temp.low) * weight);
+    return true;
+}
+
+/**
+ * Computes several approximate quantiles with
+ * one traversal of the tree. Each quantile q is
+ * answered as the rank ceil(q * N) using the same
+ * interpolation rule as the median, so q = 0.5
+ * returns exactly getApproxMedian().
+ *
+ * Arguments
+ *      qs: Quantiles to compute, each within [0, 1]
+ *      k: Number of quantiles in qs
+ *      out: Receives the value of qs[i] at out[i], or
+ *           -1 if the tree is empty or qs[i] is invalid
+ */
+void
+IntervalTree::getApproxQuantiles(const double *qs, size_t k, double *out)
+{
+    std::vector<long> ranks;
+    std::vector<size_t> slots;
+
+    if (nodesAdded == 0) {
+        std::cout << "[QUANTILE] Tree is Empty" << std::endl;
+        for (size_t i = 0; i < k; i++) {
+            out[i] = -1;
         }
+        return;
     }
 
-    tempLeft = tree[leftChild].intervalSpan;
-    tempRight = tree[rightChild].intervalSpan;
+    for (size_t i = 0; i < k; i++) {
+        if (!(qs[i] >= 0.0 && qs[i] <= 1.0)) {
+            std::cout << "[QUANTILE] Quantile not within limit" << std::endl;
+            out[i] = -1;
+            continue;
+        }
+        slots.push_back(i);
+    }
+    std::sort(slots.begin(), slots.end(), [qs](size_t a, size_t b) {
+        return qs[a] < qs[b];
+    });
 
-    if (tree[index].observationsInInterval == K) {
-        long leftObservation = tree[leftChild].observationsInInterval;
-        long rightObservation = tree[rightChild].observationsInInterval;
+    for (size_t i = 0; i < slots.size(); i++) {
+        long K = ceil(nodesAdded * qs[slots[i]]);
+        ranks.push_back(K < 1 ? 1 : K);
+    }
 
-        double leftMidPoint = (tempLeft.low + tempLeft.high) / 2.0;
-        double rightMidPoint = (tempRight.low + tempRight.high) / 2.0;
+    if (!slots.empty()) {
+        _getApproxQuantiles(0, &ranks[0], &slots[0], slots.size(), out);
+    }
+}
 
-        double leftWeight = (double)leftObservation * leftMidPoint;
-        double rightWeight = (double)rightObservation * rightMidPoint;
-        double overallWeight = leftWeight + rightWeight;
+/**
+ * Resolves a batch of ranks against the
+ * Tree/SubTree at index, splitting the batch
+ * between the children so every node is
+ * visited at most once.
+ *
+ * Arguments
+ *      index: Node of the tree to resolve at
+ *      K: Ranks within the node, sorted ascending
+ *      slots: Output position of each rank
+ *      count: Number of ranks in the batch
+ *      out: Output array of the quantiles
+ */
+void
+IntervalTree::_getApproxQuantiles(long index, long *K, const size_t *slots, size_t count, double *out)
+{
+    long leftChild = (index << 1) + 1;
+    long rightChild = (index << 1) + 2;
+    long leftObservation;
+    size_t split = 0;
 
-        return overallWeight / (double)(leftObservation + rightObservation);
+    if (isLeafNode(index)) {
+        for (size_t i = 0; i < count; i++) {
+            _resolveRank(index, K[i], &out[slots[i]]);
+        }
+        return;
     }
 
-    if (tree[leftChild].observationsInInterval >= K) {
-        return _getApproxMedian(leftChild, K);
-    } else {
-        K = K - tree[leftChild].observationsInInterval;
-        return _getApproxMedian(rightChild, K);
+    leftObservation = tree[leftChild].observationsInInterval;
+    while (split < count && K[split] <= leftObservation) {
+        split++;
+    }
+    for (size_t i = split; i < count; i++) {
+        K[i] -= leftObservation;
     }
 
-    // Control flow should never reach here. Error!
-    return -1;
+    if (split > 0) {
+        _getApproxQuantiles(leftChild, K, slots, split, out);
+    }
+    if (split < count) {
+        _getApproxQuantiles(rightChild, K + split, slots + split, count - split, out);
+    }
 }
 
 /**
@@ -7,6 +7,9 @@
  * Copyright: Yash Gupta, SSRC - UC Santa Cruz
  */
 
+#ifndef INTERVAL_TREE_H
+#define INTERVAL_TREE_H
+
 #include <stdio.h>
 #include <iostream>
 #include <math.h>
@@ -37,6 +40,8 @@ class IntervalTree {
     void _add(long, double);
     void _displayTree(long);
     double _getApproxMedian(long, long);
+    bool _resolveRank(long, long, double*);
+    void _getApproxQuantiles(long, long*, const size_t*, size_t, double*);
 
     /**
      * Get boolean value to know
@@ -73,6 +78,40 @@ public:
      */
     void displayTree();
 
+    /**
+     * Remove all observations from the tree
+     * while keeping its intervals allocated
+     */
+    void clear();
+
+    /**
+     * Get the number of leaf nodes, which is
+     * the size of the leaf observation arrays
+     */
+    long getLeafCount() {
+        return _treeSize - (_treeSize >> 1);
+    }
+
+    /**
+     * Copy out or load the observation count
+     * of every leaf, from left to right
+     */
+    void getLeafObservations(long*);
+    void setLeafObservations(const long*);
+
+    /**
+     * Get the leaf an observation would be
+     * added to, or -1 if it is out of limit
+     */
+    long getLeafIndex(double);
+
+    /**
+     * Get the interval spanned by a leaf
+     */
+    Interval getLeafSpan(long leaf) {
+        return tree[(_treeSize >> 1) + leaf].intervalSpan;
+    }
+
 
     /**
      * Wrapper for using the EDM algorithm
@@ -80,6 +119,12 @@ public:
      */
     double getApproxMedian();
 
+    /**
+     * Compute several approximate quantiles
+     * in a single traversal of the tree
+     */
+    void getApproxQuantiles(const double*, size_t, double*);
+
     /**
      * Get the number of observations added
      * to the tree
@@ -88,3 +133,5 @@ public:
         return nodesAdded;
     }
 };
+
+#endif /* INTERVAL_TREE_H */
@@ -32,17 +32,23 @@
  */
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include "IntervalTree.h"
 #include <iostream>
+#include <random>
 #include <string>
 #include <vector>
 
 using namespace std;
 
 bool g_verbose = false;
+int g_tied = 0;             // Lost sample sets whose error equals the reference error
+double g_our_error = 0;     // Sum of our absolute median errors
+double g_edm_error = 0;     // Sum of the reference absolute median errors
 
 #define check(x) { if (!(x)) { cerr << "Failed at line " << __LINE__ << ": " #x << endl; abort(); } }
 
@@ -64,13 +70,13 @@ double vector_median(const vector<double> &v) {
 }
 
 /**
- * Read one line from an istream and use the data to test an interval tree
+ * Read one sample set line from an istream
  * @param in an istream to read data from
- * @return true on success, false on failure
+ * @param exp_median receives the median calculated by the reference code
+ * @param samples receives the samples of the set
  */
-bool test_interval_tree_using_samples(istream &in) {
+void read_sample_set(istream &in, double &exp_median, vector<double> &samples) {
     size_t sample_size;
-    double exp_median;
 
     in >> sample_size;
     check (!in.fail() && in.peek() == ',')
@@ -79,9 +85,7 @@ bool test_interval_tree_using_samples(istream &in) {
     check (!in.fail() && in.peek() == ',')
     in.seekg(1, in.cur);    // skip ','
 
-    const int tree_depth = (int)std::ceil(std::log(sample_size));
-    IntervalTree test(true, tree_depth);
-    vector<double> samples(sample_size);
+    samples.resize(sample_size);
     for (size_t i = 0; i < sample_size; ++i) {
         double d;
         in >> d;
@@ -91,15 +95,38 @@ bool test_interval_tree_using_samples(istream &in) {
         } else {
             check(in.peek() == '\n' || in.peek() == EOF);
         }
-        test.add(d);
         samples[i] = d;
         in.seekg(1, in.cur);    // skip ',' or '\n'
     }
+}
+
+/**
+ * Read one line from an istream and use the data to test an interval tree
+ * @param in an istream to read data from
+ * @return true on success, false on failure
+ */
+bool test_interval_tree_using_samples(istream &in) {
+    double exp_median;
+    vector<double> samples;
+
+    read_sample_set(in, exp_median, samples);
+    size_t sample_size = samples.size();
+
+    const int tree_depth = (int)std::ceil(std::log(sample_size));
+    IntervalTree test(true, tree_depth);
+    for (size_t i = 0; i < sample_size; ++i) {
+        test.add(samples[i]);
+    }
     sort(samples.begin(), samples.end());
     double real_median = vector_median(samples);
     double edm_error = abs(real_median - exp_median);
     double our_error = abs(real_median - test.getApproxMedian());
     bool won = (our_error < edm_error);
+    if (our_error == edm_error) {
+        ++g_tied;
+    }
+    g_our_error += our_error;
+    g_edm_error += edm_error;
     if (g_verbose) {
         cerr << "Sample size: " << sample_size
              << ", expected value " << exp_median
@@ -118,16 +145,204 @@ bool test_interval_tree_using_samples(istream &in) {
     return won;
 }
 
+#define CALIBRATION_BUCKETS     6   // Sample sizes are bucketed by their power of ten
+#define CALIBRATION_MAX_DEPTH   16  // Deepest tree measured
+#define CALIBRATION_MEDIANS     16  // Median queries timed per tree
+
+struct calibration_cell {
+    double error_sum;
+    double build_nanos_sum;
+    double add_nanos_sum;
+    double median_nanos_sum;
+    long cases;
+};
+
+calibration_cell g_calibration[CALIBRATION_BUCKETS][CALIBRATION_MAX_DEPTH + 1];
+
+double nanos_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Read one line from an istream and measure the median error and
+ * the cost of interval trees of every depth on it
+ * @param in an istream to read data from
+ */
+void calibrate_using_samples(istream &in) {
+    double exp_median;
+    vector<double> samples;
+
+    read_sample_set(in, exp_median, samples);
+    vector<double> sorted(samples);
+    sort(sorted.begin(), sorted.end());
+    double real_median = vector_median(sorted);
+    int bucket = (int)std::floor(std::log10((double)samples.size()) + 0.5);
+    bucket = min(max(bucket, 0), CALIBRATION_BUCKETS - 1);
+
+    for (int depth = 1; depth <= CALIBRATION_MAX_DEPTH; ++depth) {
+        calibration_cell &cell = g_calibration[bucket][depth];
+        volatile double median = 0;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        IntervalTree test(true, depth);
+        cell.build_nanos_sum += nanos_since(start);
+
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < samples.size(); ++i) {
+            test.add(samples[i]);
+        }
+        cell.add_nanos_sum += nanos_since(start) / samples.size();
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < CALIBRATION_MEDIANS; ++i) {
+            median = test.getApproxMedian();
+        }
+        cell.median_nanos_sum += nanos_since(start) / CALIBRATION_MEDIANS;
+
+        cell.error_sum += abs(real_median - median);
+        cell.cases += 1;
+    }
+}
+
+/**
+ * Print the averaged calibration results as the DepthCostTable.h header
+ */
+void print_calibration_table() {
+    cout << "/*" << endl
+         << " * Cost model of IntervalTree depths used by" << endl
+         << " * Breakpoint::tuneTreeDepth()" << endl
+         << " *" << endl
+         << " * Generated by \"edm-test -c\", do not edit." << endl
+         << " */" << endl << endl
+         << "#ifndef DEPTH_COST_TABLE_H" << endl
+         << "#define DEPTH_COST_TABLE_H" << endl << endl
+         << "struct DepthCost {" << endl
+         << "    int sampleSizeLog10;        // Sample sizes of this row, rounded power of ten" << endl
+         << "    unsigned long depth;        // Depth of the tree" << endl
+         << "    double medianError;         // Mean absolute error of the approximate median" << endl
+         << "    double buildNanos;          // Time to allocate and construct the tree" << endl
+         << "    double addNanos;            // Time of one add" << endl
+         << "    double medianNanos;         // Time of one median query" << endl
+         << "};" << endl << endl
+         << "static const DepthCost depthCostTable[] = {" << endl;
+    for (int bucket = 0; bucket < CALIBRATION_BUCKETS; ++bucket) {
+        for (int depth = 1; depth <= CALIBRATION_MAX_DEPTH; ++depth) {
+            const calibration_cell &cell = g_calibration[bucket][depth];
+            if (cell.cases == 0) continue;
+            cout << "    {" << bucket << ", " << depth << ", "
+                 << cell.error_sum / cell.cases << ", "
+                 << cell.build_nanos_sum / cell.cases << ", "
+                 << cell.add_nanos_sum / cell.cases << ", "
+                 << cell.median_nanos_sum / cell.cases << "}," << endl;
+        }
+    }
+    cout << "};" << endl << endl
+         << "#endif /* DEPTH_COST_TABLE_H */" << endl;
+}
+
+/**
+ * Run fn on every sample set of an input csv
+ * @param infile_name the csv to read
+ * @param fn returns true if the sample set won
+ * @param won receives the number of sample sets that won
+ * @param lost receives the number of sample sets that lost
+ */
+template <typename F>
+void for_each_sample_set(const char *infile_name, F fn, int &won, int &lost) {
+    cerr << "Loading test cases from " << infile_name << endl;
+    ifstream fin(infile_name);
+    fin.exceptions( ifstream::failbit | ifstream::badbit | ifstream::eofbit );
+    string s; getline(fin, s); // skip the header line
+
+    try {
+        for (;;) {
+            if (!fn(fin))
+                ++lost;
+            else
+                ++won;
+        }
+    } catch(ifstream::failure &e) {
+        if (!fin.eof())
+            throw e;
+    }
+}
+
+/**
+ * Write generated sample sets in the csv format read by this program.
+ * Half of the sets are uniform samples, the other half are distances
+ * |u1 - u2| of uniform samples, like the distances Breakpoint adds to
+ * its trees. The output only depends on the arguments.
+ * @param out the ostream to write to
+ * @param sets number of sample sets
+ * @param min_size smallest sample size
+ * @param max_size largest sample size
+ * @param seed seed of the generator
+ */
+void generate_sample_sets(ostream &out, long sets, long min_size, long max_size,
+                          unsigned long seed) {
+    mt19937_64 generator(seed);
+    // Uniform in [0, 1) from the top 53 bits, identical on every platform
+    auto uniform = [&generator]() { return (double)(generator() >> 11) / 9007199254740992.0; };
+
+    out << "sample_size,calculated_approx_median,samples" << endl;
+    out.precision(17);
+    for (long set = 0; set < sets; ++set) {
+        size_t sample_size = min_size + generator() % (max_size - min_size + 1);
+        vector<double> samples(sample_size);
+        for (size_t i = 0; i < sample_size; ++i) {
+            samples[i] = (set % 2 == 0) ? uniform() : abs(uniform() - uniform());
+        }
+        vector<double> sorted(samples);
+        sort(sorted.begin(), sorted.end());
+
+        out << sample_size << ',' << vector_median(sorted);
+        for (size_t i = 0; i < sample_size; ++i) {
+            out << ',' << samples[i];
+        }
+        out << endl;
+    }
+}
+
 /**
  * Display usage information.
  */
 void usage(void) {
 	cerr << "Usage: $0 [-v] input_sample_csv" << endl;
-	cerr << " -v:   Verbose mode. Display results of every test case.";
+	cerr << "       $0 -c input_sample_csv..." << endl;
+	cerr << "       $0 -g sets min_size max_size seed" << endl;
+	cerr << " -v:   Verbose mode. Display results of every test case." << endl;
+	cerr << " -c:   Calibrate tree depths and print DepthCostTable.h to stdout." << endl;
+	cerr << " -g:   Print generated calibration sample sets to stdout." << endl;
 }
 
 int main(int argc, const char **argv) {
 	const char *infile_name = NULL;
+	int success_cases = 0;
+	int failed_cases = 0;
+
+	if (argc == 6 && 0 == strcmp("-g", argv[1])) {
+	    long sets = atol(argv[2]);
+	    long min_size = atol(argv[3]);
+	    long max_size = atol(argv[4]);
+	    if (sets < 1 || min_size < 1 || max_size < min_size) {
+	        usage();
+	        return 2;
+	    }
+	    generate_sample_sets(cout, sets, min_size, max_size, strtoul(argv[5], NULL, 10));
+	    return 0;
+	}
+
+	if (argc >= 3 && 0 == strcmp("-c", argv[1])) {
+	    for (int i = 2; i < argc; ++i) {
+	        for_each_sample_set(argv[i], [](istream &in) {
+	            calibrate_using_samples(in);
+	            return true;
+	        }, success_cases, failed_cases);
+	    }
+	    print_calibration_table();
+	    cerr << "Finished. Calibrated " << success_cases << " sample sets" << endl;
+	    return 0;
+	}
 
 	if (argc != 2 && argc != 3) {
 	    usage();
@@ -146,25 +361,15 @@ int main(int argc, const char **argv) {
 	    infile_name = argv[1];
 	}
 
-	cerr << "Loading test cases from " << infile_name << endl;
-    ifstream fin(infile_name);
-    fin.exceptions( ifstream::failbit | ifstream::badbit | ifstream::eofbit );
-    string s; getline(fin, s); // skip the header line
+	for_each_sample_set(infile_name, test_interval_tree_using_samples,
+	                    success_cases, failed_cases);
 
-    int success_cases = 0;
-    int failed_cases = 0;
-    try {
-        for (;;) {
-            if (!test_interval_tree_using_samples(fin))
-                ++failed_cases;
-            else
-                ++success_cases;
-        }
-    } catch(ifstream::failure &e) {
-        if (!fin.eof())
-            throw e;
+    cerr << "Finished. Won " << success_cases << ", lost " << failed_cases
+         << " (" << g_tied << " tied)" << endl;
+    if (success_cases + failed_cases > 0) {
+        cerr << "Mean absolute error: ours "
+             << g_our_error / (success_cases + failed_cases)
+             << ", reference " << g_edm_error / (success_cases + failed_cases) << endl;
     }
-
-    cerr << "Finished. Won " << success_cases << ", lost " << failed_cases << endl;
     return 0;
 }
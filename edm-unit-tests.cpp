@@ -6,16 +6,24 @@
  * Copyright: Yash Gupta, SSRC - UC Santa Cruz
  */
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include "ConcurrentIntervalTree.h"
+#include "DecayedIntervalTree.h"
 #include "EDM.h"
 #include <iostream>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
+#define check(x) { if (!(x)) { cerr << "Failed at line " << __LINE__ << ": " #x << endl; abort(); } }
+
 bool test_breakpoint() {
 	const size_t sigma = 24;
 	const size_t n = 100;
-    const int tree_depth = (int)std::ceil(std::log(n));
+    const int tree_depth = Breakpoint::tuneTreeDepth(n, sigma, 0.02, 0);
 	double d[n];
 
 	for (size_t i = 0; i < n/2; ++i)
@@ -28,6 +36,290 @@ bool test_breakpoint() {
     return true;
 }
 
+bool test_multiscale_breakpoint() {
+	const size_t n = 100;
+	const int tree_depth = (int)std::ceil(std::log(n));
+	const long deltas[] = {24, 8, 32, 12, 16, 60};
+	const long delta_count = sizeof(deltas) / sizeof(deltas[0]);
+	long locations[delta_count];
+	double d[n];
+
+	for (size_t i = 0; i < n; ++i)
+		d[i] = (i < 40 ? 30 : 10) + (double)((i * 7) % 11);
+
+	Breakpoint multi(d, n, deltas[0], tree_depth);
+	multi.getBreakpointLocations(deltas, delta_count, locations);
+	for (long k = 0; k < delta_count; ++k) {
+		if (2 * deltas[k] - 1 > (long)n) {
+			check(locations[k] == -1);
+			continue;
+		}
+		Breakpoint single(d, n, deltas[k], tree_depth);
+		long expected = single.getBreakpointLocation();
+		cout << "Delta " << deltas[k] << " breakpoint: " << locations[k] << endl;
+		check(locations[k] == expected);
+	}
+
+	// Noisy series and other depths must match separate runs as well
+	unsigned long seed = 2016;
+	for (int trial = 0; trial < 12; ++trial) {
+		const int depth = 3 + 3 * (trial % 4);
+		const size_t step = 20 + (trial * 13) % 60;
+		for (size_t i = 0; i < n; ++i) {
+			seed = (seed * 1103515245 + 12345) % 2147483648UL;
+			d[i] = (i < step ? 2 : 1) + (double)seed / 2147483648.0;
+		}
+		Breakpoint noisy(d, n, deltas[0], depth);
+		noisy.getBreakpointLocations(deltas, delta_count, locations);
+		for (long k = 0; k < delta_count; ++k) {
+			if (locations[k] == -1)
+				continue;
+			Breakpoint single(d, n, deltas[k], depth);
+			check(locations[k] == single.getBreakpointLocation());
+		}
+	}
+	return true;
+}
+
+bool test_breakpoint_significance() {
+	const size_t sigma = 24;
+	const size_t n = 100;
+	const int tree_depth = (int)std::ceil(std::log(n));
+	double d[n];
+
+	for (size_t i = 0; i < n; ++i)
+		d[i] = (i < sigma ? 30 : 10) + (double)((i * 7) % 11);
+
+	Breakpoint bp(d, n, sigma, tree_depth);
+	long location = bp.getBreakpointLocation();
+	BreakpointSignificance full = bp.getSignificance(199, 0.05, 4, false, 1);
+	cout << "Breakpoint " << location << " p-value: " << full.pValue
+	     << " (" << full.permutations << " permutations, "
+	     << full.elapsedSeconds << " s)" << endl;
+	check(full.permutations == 199);
+	check(!full.earlyStopped);
+	check(full.pValue < 0.05);
+	check(full.elapsedSeconds >= 0);
+
+	BreakpointSignificance early = bp.getSignificance(999, 0.05, 4, true, 1);
+	cout << "Early stopped after " << early.permutations << " permutations, p-value: "
+	     << early.pValue << endl;
+	check(early.earlyStopped);
+	check(early.permutations < 999);
+	check(early.pValue < 0.05);
+	check(bp.getBreakpointLocation() == location);
+
+	// A seed gives the same result for any thread count
+	BreakpointSignificance serial = bp.getSignificance(199, 0.05, 1, false, 1);
+	check(serial.exceedances == full.exceedances);
+	check(serial.pValue == full.pValue);
+	BreakpointSignificance early_serial = bp.getSignificance(999, 0.05, 1, true, 1);
+	BreakpointSignificance early_wide = bp.getSignificance(999, 0.05, 7, true, 1);
+	check(early_serial.permutations == early.permutations);
+	check(early_wide.permutations == early.permutations);
+	check(early_wide.pValue == early.pValue);
+
+	// Repeatable on another series and seed as well
+	double weak[n];
+	for (size_t i = 0; i < n; ++i)
+		weak[i] = (double)((i * 37) % 17) + (i < sigma ? 0.5 : 0);
+	Breakpoint noise(weak, n, sigma, tree_depth);
+	BreakpointSignificance a = noise.getSignificance(128, 0.05, 3, true, 42);
+	BreakpointSignificance b = noise.getSignificance(128, 0.05, 2, true, 42);
+	cout << "Second series p-value: " << a.pValue << " after " << a.permutations << " permutations" << endl;
+	check(a.permutations == b.permutations && a.exceedances == b.exceedances);
+	return true;
+}
+
+bool test_approx_quantiles() {
+	const size_t n = 1000;
+	const double qs[] = {0.75, 0.5, 0.25, 0.0, 1.0, 1.5};
+	const size_t k = sizeof(qs) / sizeof(qs[0]);
+	const double leaf_width = 1.0 / 128;
+	double out[k];
+	vector<double> samples(n);
+	IntervalTree tree(true, 8);
+
+	unsigned long seed = 12345;
+
+	for (size_t i = 0; i < n; ++i) {
+		seed = (seed * 1103515245 + 12345) % 2147483648UL;
+		double x = (double)seed / 2147483648.0;
+		samples[i] = x * x;
+		tree.add(samples[i]);
+	}
+	sort(samples.begin(), samples.end());
+	tree.getApproxQuantiles(qs, k, out);
+	cout << "Approximate quartiles: " << out[2] << " " << out[1] << " " << out[0] << endl;
+	check(out[1] == tree.getApproxMedian());
+	check(std::abs(out[0] - samples[n * 3 / 4]) < 2 * leaf_width);
+	check(std::abs(out[2] - samples[n / 4]) < 2 * leaf_width);
+	check(out[3] <= out[2] && out[2] <= out[1] && out[1] <= out[0]);
+	check(out[0] <= out[4]);
+	check(std::abs(out[4] - samples[n - 1]) < leaf_width);
+	check(out[5] == -1);
+
+	// Every rank, including those equal to a node count, is monotonic
+	const size_t grid = 101;
+	double grid_qs[grid];
+	double grid_out[grid];
+	for (size_t i = 0; i < grid; ++i)
+		grid_qs[i] = (double)i / (grid - 1);
+	tree.getApproxQuantiles(grid_qs, grid, grid_out);
+	for (size_t i = 0; i < grid; ++i) {
+		size_t rank = (size_t)std::ceil(grid_qs[i] * n);
+		check(std::abs(grid_out[i] - samples[rank > 0 ? rank - 1 : 0]) < 2 * leaf_width);
+		if (i > 0)
+			check(grid_out[i - 1] <= grid_out[i]);
+	}
+
+	// Ranks landing exactly on a subtree count
+	IntervalTree even(true, 8);
+	for (size_t i = 0; i < n; ++i) {
+		double x = (double)i * 0.6180339887;
+		even.add(x - std::floor(x));
+	}
+	cout << "Evenly spread median: " << even.getApproxMedian() << endl;
+	check(std::abs(even.getApproxMedian() - 0.5) < leaf_width);
+	return true;
+}
+
+bool test_decayed_interval_tree() {
+	DecayedIntervalTree decayed(8, 0.99);
+	IntervalTree plain(true, 8);
+
+	for (size_t i = 0; i < 600; ++i) {
+		decayed.add(0.2);
+		plain.add(0.2);
+	}
+	for (size_t i = 0; i < 400; ++i) {
+		decayed.add(0.8);
+		plain.add(0.8);
+	}
+	cout << "Decayed median: " << decayed.getApproxMedian()
+	     << ", plain median: " << plain.getApproxMedian() << endl;
+	check(decayed.getApproxMedian() > 0.75);
+	check(plain.getApproxMedian() < 0.25);
+	check(std::abs(decayed.getWeight() - (1 - std::pow(0.99, 1000)) / 0.01) < 1e-6);
+
+	// Force several renormalizations of the stored weights
+	DecayedIntervalTree fast(8, 0.5);
+	for (size_t i = 0; i < 5000; ++i)
+		fast.add(i < 4990 ? 0.9 : 0.1);
+	cout << "Fast decayed median: " << fast.getApproxMedian() << endl;
+	check(fast.getApproxMedian() < 0.15);
+	check(std::abs(fast.getWeight() - 2.0) < 1e-9);
+	return true;
+}
+
+bool test_tune_tree_depth() {
+	const long n = 100;
+	const long sigma = 24;
+	const double target = 0.02;
+	double error, seconds;
+
+	unsigned long coarse = Breakpoint::tuneTreeDepth(n, sigma, 1.0, 0);
+	unsigned long fine = Breakpoint::tuneTreeDepth(n, sigma, target, 0);
+	unsigned long best = Breakpoint::tuneTreeDepth(n, sigma, 0, 0);
+	unsigned long rushed = Breakpoint::tuneTreeDepth(n, sigma, 0, 1e-12);
+	cout << "Tuned depths: coarse " << coarse << ", fine " << fine
+	     << ", best " << best << ", rushed " << rushed << endl;
+
+	// Check the choices against the estimates, whatever the calibration
+	check(Breakpoint::estimateTreeDepth(n, sigma, fine, &error, &seconds));
+	check(error <= target);
+	double best_error = error;
+	check(Breakpoint::estimateTreeDepth(n, sigma, best, &best_error, &seconds));
+	double rushed_error, rushed_seconds;
+	check(Breakpoint::estimateTreeDepth(n, sigma, rushed, &rushed_error, &rushed_seconds));
+	check(coarse <= fine);
+	for (unsigned long depth = 1; depth < 64; ++depth) {
+		if (!Breakpoint::estimateTreeDepth(n, sigma, depth, &error, &seconds))
+			continue;
+		if (depth < fine)
+			check(error > target);
+		if (depth < coarse)
+			check(error > 1.0);
+		check(error >= best_error);
+		check(seconds >= rushed_seconds);
+	}
+	return true;
+}
+
+double stress_value(size_t writer, size_t i) {
+	unsigned long x = (writer + 1) * 2654435761UL + i * 40503UL;
+	x = (x * 1103515245 + 12345) % 2147483648UL;
+	return (double)x / 2147483647.0;
+}
+
+bool test_concurrent_interval_tree() {
+	const unsigned long depth = 10;
+	const size_t writers = 4;
+	const size_t per_writer = 50000;
+	IntervalTree expected(true, depth);
+	vector<long> expected_leaves(expected.getLeafCount());
+	vector<long> actual_leaves(expected.getLeafCount());
+
+	for (size_t w = 0; w < writers; ++w)
+		for (size_t i = 0; i < per_writer; ++i)
+			expected.add(stress_value(w, i));
+	expected.getLeafObservations(&expected_leaves[0]);
+
+	// Baseline: one writer doing all adds through one shard
+	ConcurrentIntervalTree single(depth, 1);
+	chrono::steady_clock::time_point single_start = chrono::steady_clock::now();
+	for (size_t w = 0; w < writers; ++w)
+		for (size_t i = 0; i < per_writer; ++i)
+			single.add(stress_value(w, i), 0);
+	double single_rate = writers * per_writer /
+		chrono::duration<double>(chrono::steady_clock::now() - single_start).count();
+	cout << "Single writer adds: " << single_rate << " adds/s" << endl;
+	check(single.getSize() == expected.getSize());
+
+	double sharded_rate = 0;
+	for (unsigned shards = 1; shards <= writers; shards += writers - 1) {
+		ConcurrentIntervalTree tree(depth, shards);
+		IntervalTree snapshot(true, depth);
+		vector<thread> threads;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (size_t w = 0; w < writers; ++w) {
+			threads.push_back(thread([&tree, w, per_writer]() {
+				for (size_t i = 0; i < per_writer; ++i)
+					tree.add(stress_value(w, i), w);
+			}));
+		}
+		for (size_t w = 0; w < writers; ++w) {
+			// Query while writers are running
+			double median = tree.getApproxMedian();
+			check(median == -1 || (median >= 0 && median <= 1));
+		}
+		for (size_t w = 0; w < writers; ++w)
+			threads[w].join();
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		cout << "Concurrent adds with " << shards << " shards: "
+		     << writers * per_writer / seconds << " adds/s" << endl;
+		if (shards == writers)
+			sharded_rate = writers * per_writer / seconds;
+
+		tree.snapshot(snapshot);
+		snapshot.getLeafObservations(&actual_leaves[0]);
+		check(actual_leaves == expected_leaves);
+		check(tree.getSize() == expected.getSize());
+		check(snapshot.getSize() == expected.getSize());
+		check(tree.getApproxMedian() == expected.getApproxMedian());
+	}
+
+	// Sharded writers only scale with a core each
+	if (thread::hardware_concurrency() >= writers) {
+		check(sharded_rate > 1.5 * single_rate);
+	} else {
+		cout << "Skipping scaling check: " << thread::hardware_concurrency()
+		     << " hardware threads" << endl;
+	}
+	return true;
+}
+
 /* Test Driver */
 int main()
 {
@@ -43,6 +335,12 @@ int main()
     std::cout << "Approximate Median: " << test.getApproxMedian() << std::endl;
 
     test_breakpoint();
+    test_multiscale_breakpoint();
+    test_breakpoint_significance();
+    test_approx_quantiles();
+    test_decayed_interval_tree();
+    test_tune_tree_depth();
+    test_concurrent_interval_tree();
 
     return 0;
 }